@@ -0,0 +1,206 @@
+#include <string.h>
+#include "emit.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define EMIT_X86 1
+#endif
+
+typedef size_t (*CompactFn)(uint64_t lo, const uint64_t *bits, size_t words, uint32_t *out);
+
+static size_t compactScalar(uint64_t lo, const uint64_t *bits, size_t words, uint32_t *out) {
+    size_t n = 0;
+    for (size_t w = 0; w < words; w++) {
+        uint64_t m = bits[w];
+        uint32_t base = (uint32_t)(lo + 1 + 128 * w);
+        while (m) {
+            out[n++] = base + 2 * (uint32_t)__builtin_ctzll(m);
+            m &= m - 1;
+        }
+    }
+    return n;
+}
+
+static CompactFn compactKernel = compactScalar;
+
+#ifdef EMIT_X86
+
+/*
+ * AVX-512 Compaction
+ *
+ * Each 16-bit slice of a bitmap word selects lanes of a vector holding the
+ * 16 candidate values; VPCOMPRESSD packs the selected lanes to the front and
+ * one unaligned store appends them. The store always writes 16 lanes, hence
+ * COMPACT_SLACK.
+ */
+__attribute__((target("avx512f")))
+static size_t compactAvx512(uint64_t lo, const uint64_t *bits, size_t words, uint32_t *out) {
+    const __m512i steps = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    size_t n = 0;
+    for (size_t w = 0; w < words; w++) {
+        uint64_t m = bits[w];
+        if (!m) continue;
+        uint32_t base = (uint32_t)(lo + 1 + 128 * w);
+        for (int j = 0; j < 4; j++) {
+            __mmask16 k = (__mmask16)(m >> (16 * j));
+            if (!k) continue;
+            __m512i values = _mm512_add_epi32(_mm512_set1_epi32((int)(base + 32 * j)), steps);
+            _mm512_storeu_si512((void*)(out + n), _mm512_maskz_compress_epi32(k, values));
+            n += (size_t)__builtin_popcount(k);
+        }
+    }
+    return n;
+}
+
+// permuteTable[m] lists the set bit positions of the byte m, for VPERMD
+static uint32_t permuteTable[256][8];
+
+/*
+ * AVX2 Compaction
+ *
+ * AVX2 has no compress instruction, so each 8-bit slice of the bitmap looks
+ * up a shuffle pattern that moves the selected lanes to the front.
+ */
+__attribute__((target("avx2")))
+static size_t compactAvx2(uint64_t lo, const uint64_t *bits, size_t words, uint32_t *out) {
+    const __m256i steps = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    size_t n = 0;
+    for (size_t w = 0; w < words; w++) {
+        uint64_t m = bits[w];
+        if (!m) continue;
+        uint32_t base = (uint32_t)(lo + 1 + 128 * w);
+        for (int j = 0; j < 8; j++) {
+            unsigned k = (unsigned)(m >> (8 * j)) & 0xff;
+            if (!k) continue;
+            __m256i values = _mm256_add_epi32(_mm256_set1_epi32((int)(base + 16 * j)), steps);
+            __m256i pattern = _mm256_loadu_si256((const __m256i*)permuteTable[k]);
+            _mm256_storeu_si256((__m256i*)(out + n), _mm256_permutevar8x32_epi32(values, pattern));
+            n += (size_t)__builtin_popcount(k);
+        }
+    }
+    return n;
+}
+
+#endif // EMIT_X86
+
+void initEmit() {
+    static int initialized = 0;
+    if (initialized) return;
+    initialized = 1;
+
+#ifdef EMIT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        compactKernel = compactAvx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        for (unsigned m = 0; m < 256; m++) {
+            int n = 0;
+            for (int b = 0; b < 8; b++) {
+                if (m & (1u << b)) permuteTable[m][n++] = (uint32_t)b;
+            }
+        }
+        compactKernel = compactAvx2;
+    }
+#endif
+}
+
+size_t compactPrimes(uint64_t lo, const uint64_t *bits, size_t words, uint32_t *out) {
+    return compactKernel(lo, bits, words, out);
+}
+
+/*
+ * Integer to Decimal
+ *
+ * Every value below 10^8 becomes eight digit bytes at once (SSE2 on x86,
+ * a scalar loop elsewhere). Leading zeros are then dropped by shifting the
+ * 64-bit digit word and the whole word is stored unaligned, hence FORMAT_SLACK.
+ * Values of 10^8 and above write their one or two leading digits first.
+ */
+#ifdef EMIT_X86
+
+// value < 10^8 -> eight 16-bit lanes holding its digits, most significant first
+static inline __m128i eightDigits(uint32_t value) {
+    const __m128i div10000 = _mm_set1_epi32((int)0xd1b71759); // ceil(2^45 / 10^4)
+    const __m128i mul10000 = _mm_set1_epi32(10000);
+    // x * 4 * divPowers >> 16, then * shiftPowers >> 16: x / 10^3, x / 10^2, x / 10, x
+    const __m128i divPowers = _mm_setr_epi16(8389, 5243, 13108, (short)32768, 8389, 5243, 13108, (short)32768);
+    const __m128i shiftPowers = _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, (short)(1 << 15),
+                                               1 << 7, 1 << 11, 1 << 13, (short)(1 << 15));
+    const __m128i ten = _mm_set1_epi16(10);
+
+    __m128i abcdefgh = _mm_cvtsi32_si128((int)value);
+    __m128i abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh, div10000), 45);
+    __m128i efgh = _mm_sub_epi32(abcdefgh, _mm_mul_epu32(abcd, mul10000));
+
+    // [abcd, abcd, abcd, abcd, efgh, efgh, efgh, efgh] * 4
+    __m128i v1 = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+    __m128i v2 = _mm_unpacklo_epi16(v1, v1);
+    v2 = _mm_unpacklo_epi32(v2, v2);
+
+    // [a, ab, abc, abcd, e, ef, efg, efgh] - 10 * [0, a, ab, abc, 0, e, ef, efg]
+    __m128i prefixes = _mm_mulhi_epu16(_mm_mulhi_epu16(v2, divPowers), shiftPowers);
+    __m128i shifted = _mm_slli_epi64(_mm_mullo_epi16(prefixes, ten), 16);
+    return _mm_sub_epi16(prefixes, shifted);
+}
+
+#else
+
+static inline uint64_t eightDigitsScalar(uint32_t value) {
+    uint64_t digits = 0;
+    for (int i = 7; i >= 0; i--) {
+        digits |= (uint64_t)(value % 10) << (8 * i);
+        value /= 10;
+    }
+    return digits;
+}
+
+#endif // EMIT_X86
+
+// Appends one value given its low eight digits as bytes (first digit in the lowest byte)
+static inline char* writeLine(char *out, uint32_t value, uint64_t digits) {
+    const uint64_t ascii = 0x3030303030303030ULL;
+    if (value >= 100000000) {
+        uint32_t head = value / 100000000;
+        if (head >= 10) {
+            *out++ = (char)('0' + head / 10);
+        }
+        *out++ = (char)('0' + head % 10);
+        digits |= ascii;
+        memcpy(out, &digits, 8);
+        out += 8;
+    } else if (value == 0) {
+        *out++ = '0';
+    } else {
+        int leadingZeros = __builtin_ctzll(digits) / 8;
+        digits = (digits | ascii) >> (8 * leadingZeros);
+        memcpy(out, &digits, 8);
+        out += 8 - leadingZeros;
+    }
+    *out++ = '\n';
+    return out;
+}
+
+size_t formatDecimal(const uint32_t *values, size_t n, char *out) {
+    char *p = out;
+    size_t i = 0;
+#ifdef EMIT_X86
+    // Two values per 128-bit register once their digit lanes are packed to bytes
+    for (; i + 2 <= n; i += 2) {
+        uint32_t a = values[i], b = values[i + 1];
+        __m128i packed = _mm_packus_epi16(eightDigits(a % 100000000), eightDigits(b % 100000000));
+        uint64_t digitsA = (uint64_t)_mm_cvtsi128_si64(packed);
+        uint64_t digitsB = (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(packed, packed));
+        p = writeLine(p, a, digitsA);
+        p = writeLine(p, b, digitsB);
+    }
+    for (; i < n; i++) {
+        __m128i packed = _mm_packus_epi16(eightDigits(values[i] % 100000000), _mm_setzero_si128());
+        p = writeLine(p, values[i], (uint64_t)_mm_cvtsi128_si64(packed));
+    }
+#else
+    for (; i < n; i++) {
+        p = writeLine(p, values[i], eightDigitsScalar(values[i] % 100000000));
+    }
+#endif
+    return (size_t)(p - out);
+}
@@ -0,0 +1,35 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Extra elements/bytes the output buffers need past their logical end for vector stores
+#define COMPACT_SLACK 16
+#define FORMAT_SLACK 16
+
+// Longest line formatDecimal writes for one value: 10 digits and a newline
+#define DECIMAL_LINE_MAX 11
+
+/*
+ * Picks the fastest compaction kernel the CPU supports (AVX-512, AVX2 or scalar).
+ * Call once before the first compactPrimes; later calls are no-ops.
+ */
+void initEmit();
+
+/*
+ * Stream compaction of a sieve bitmap (see sieveSegment): stores lo + 2i + 1
+ * for every set bit i of bits[0..words) into out, in increasing order, and
+ * returns how many were stored. out needs room for the result plus
+ * COMPACT_SLACK elements.
+ */
+size_t compactPrimes(uint64_t lo, const uint64_t *bits, size_t words, uint32_t *out);
+
+/*
+ * Writes each value as a decimal line ("123\n") into out and returns the
+ * number of bytes written. out needs room for n * DECIMAL_LINE_MAX bytes
+ * plus FORMAT_SLACK.
+ */
+size_t formatDecimal(const uint32_t *values, size_t n, char *out);
+
+#endif // EMIT_H
@@ -5,9 +5,32 @@
 #include <stdatomic.h>
 #include <unistd.h>
 #include <sys/sysinfo.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <endian.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "sieve.h"
+#include "emit.h"
+#include "residue.h"
 
 #define MAX_QUEUE_SIZE 256 // Adjusted to ensure we stay within 2MB limit with overhead
 #define MEMORY_POOL_SIZE 10000000 // Adjusted based on expected number of nodes
+#define DEFAULT_SHARD_SIZE 1000000 // Inputs per shard handed to a worker
+#define RANGE_SEGMENT_SPAN (1ULL << 18) // Integers sieved at a time by a worker thread
+#define VALUES_CHUNK 4096 // Numbers claimed at a time by a worker thread
+#define MAX_PAYLOAD_SIZE (1ULL << 30) // Largest shard payload a worker accepts
+#define CONNECT_ATTEMPTS 3 // Connection attempts, and consecutive shard failures, before a worker is considered dead
+#define CONNECT_TIMEOUT_MS 5000 // Per connection attempt
+#define DEFAULT_SHARD_TIMEOUT_MS 120000 // Longest wait for a worker to send or answer one shard
+#define SEED_STATE_BYTES 128 // Same state size glibc's rand() uses
 
 // Node structure for the queue
 typedef struct Node {
@@ -161,6 +184,8 @@ typedef struct {
     atomic_int *total_counter;
     atomic_bool *done;
     MemoryPool *memoryPool;
+    atomic_bool *expired; // Deadline reached: abandon whatever is still queued
+    atomic_int *processed; // Inputs fully tested so far
 } PrimeCounterState;
 
 // Worker thread function to count primes
@@ -169,15 +194,18 @@ void* primeCounterWorker(void *arg) {
     int num;
     Node *dequeuedNode;
 
-    while (!atomic_load(state->done) || atomic_load(&state->queue->size) > 0) {
+    while (!atomic_load(state->expired)
+           && (!atomic_load(state->done) || atomic_load(&state->queue->size) > 0)) {
         num = dequeue(state->queue, &dequeuedNode);
         if (num == -1) {
             usleep(10); // Reduce sleep time to avoid busy-waiting
             continue;
         }
+        // A dequeued number is always finished, so the covered inputs stay a prefix of the stream
         if (isPrime(num)) {
             atomic_fetch_add(state->total_counter, 1);
         }
+        atomic_fetch_add(state->processed, 1);
     }
     return NULL;
 }
@@ -190,16 +218,98 @@ void freeQueue(Queue *queue) {
     }
 }
 
-int main() {
+bool deadlinePassed(const struct timespec *deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec
+        || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+// Buffered stdin reader that never blocks past a deadline
+typedef struct {
+    char buf[1 << 16];
+    size_t pos;
+    size_t len;
+    const struct timespec *deadline;
+} InputReader;
+
+// Returns the next byte of stdin, EOF at end of input, or -2 once the deadline has passed
+int nextByte(InputReader *in) {
+    if (in->pos == in->len) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long remaining = (in->deadline->tv_sec - now.tv_sec) * 1000LL
+            + (in->deadline->tv_nsec - now.tv_nsec + 999999) / 1000000;
+        if (remaining <= 0) return -2;
+
+        struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+        int ready = poll(&pfd, 1, remaining > INT32_MAX ? INT32_MAX : (int)remaining);
+        if (ready < 0 && errno == EINTR) return nextByte(in);
+        if (ready == 0) return -2;
+
+        ssize_t n = read(STDIN_FILENO, in->buf, sizeof(in->buf));
+        if (n < 0 && errno == EINTR) return nextByte(in);
+        if (n <= 0) return EOF;
+        in->pos = 0;
+        in->len = (size_t)n;
+    }
+    return (unsigned char)in->buf[in->pos++];
+}
+
+/*
+ * Reads the next whitespace separated integer like scanf("%d").
+ * Returns 1 with *value set, 0 at end of input, or -1 when the deadline passed first;
+ * a number cut off by the deadline is not returned.
+ */
+int readNumber(InputReader *in, int *value) {
+    int c;
+    do {
+        c = nextByte(in);
+    } while (c >= 0 && c != '-' && (c < '0' || c > '9'));
+    if (c == EOF) return 0;
+    if (c == -2) return -1;
+
+    bool negative = c == '-';
+    long long v = negative ? 0 : c - '0';
+    while ((c = nextByte(in)) >= '0' && c <= '9') {
+        v = v * 10 + (c - '0');
+    }
+    if (c == -2) return -1;
+    *value = (int)(negative ? -v : v);
+    return 1;
+}
+
+/*
+ * Stream mode: count the primes among the integers read from stdin.
+ *
+ * With deadlineMs > 0 the counter stops accepting input when the deadline
+ * passes, abandons numbers still waiting in the queue and reports how many
+ * inputs were covered. Returns 2 in that case so scripts can tell a partial
+ * answer from a complete one.
+ */
+int runStreamCounter(long deadlineMs) {
     Queue *queue = createQueue();
     atomic_int total_counter = 0;
     atomic_bool done = false;
+    atomic_bool expired = false;
+    atomic_int processed = 0;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += deadlineMs / 1000;
+    deadline.tv_nsec += (deadlineMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    static InputReader reader;
+    reader.deadline = &deadline;
 
     // Create memory pool
     MemoryPool *memoryPool = createMemoryPool();
 
     // Set up state for worker threads
-    PrimeCounterState state = {queue, &total_counter, &done, memoryPool};
+    PrimeCounterState state = {queue, &total_counter, &done, memoryPool, &expired, &processed};
 
     // Determine the number of CPU cores
     long numCPU = sysconf(_SC_NPROCESSORS_ONLN);
@@ -228,17 +338,30 @@ int main() {
 
     int num;
     int total_numbers = 0;
-    while (scanf("%d", &num) != EOF) {
+    int status;
+    while ((status = deadlineMs > 0 ? readNumber(&reader, &num) : scanf("%d", &num) != EOF) == 1) {
+        bool late = false;
         while (atomic_load(&queue->size) >= MAX_QUEUE_SIZE) {
+            if (deadlineMs > 0 && deadlinePassed(&deadline)) {
+                late = true;
+                break;
+            }
             usleep(10); // Reduce sleep time to avoid busy-waiting
         }
+        if (late) {
+            status = -1; // Deadline passed while waiting for room in the queue
+            break;
+        }
         Node *node = allocateNode(memoryPool);
         node->value = num;
         enqueue(queue, node->value);
         total_numbers++;
     }
 
-    // Signal to threads that processing is done
+    // Signal to threads that processing is done, or that the rest is abandoned
+    if (status == -1) {
+        atomic_store(&expired, true);
+    }
     atomic_store(&done, true);
 
     // Wait for all threads to finish
@@ -247,6 +370,12 @@ int main() {
     }
 
     printf("%d total primes.\n", atomic_load(&total_counter));
+    if (status == -1) {
+        fprintf(stderr, "Deadline of %ld ms reached: covered the first %d inputs, abandoned %d queued inputs.\n",
+               deadlineMs, atomic_load(&processed), total_numbers - atomic_load(&processed));
+    } else if (deadlineMs > 0) {
+        fprintf(stderr, "Covered all %d inputs within the %ld ms deadline.\n", total_numbers, deadlineMs);
+    }
 
     // Clean up
     freeQueue(queue);
@@ -254,5 +383,1150 @@ int main() {
     freeMemoryPool(memoryPool);
     free(threads);
 
+    return status == -1 ? 2 : 0;
+}
+
+/*
+ * Distributed Counting
+ *
+ * A coordinator splits a job into shards and hands them to worker processes
+ * (this same program started with --worker) over TCP. Every shard is one
+ * request/reply exchange on the worker's connection:
+ *
+ *   request: type, arg0, arg1, arg2, payloadLen  (five big-endian uint64)
+ *            followed by payloadLen bytes
+ *   reply:   primes, inputs                      (two big-endian uint64)
+ *
+ * Shard types:
+ *   SHARD_RANGE   - every integer in [arg0, arg1), counted with a segmented sieve
+ *   SHARD_NUMBERS - newline separated integers carried in the payload
+ *   SHARD_SEED    - arg2 numbers of a randomGenerator stream, continued from
+ *                   the generator state in the payload (SEED_STATE_BYTES as
+ *                   big-endian int32 words) with read/write offsets arg0, arg1
+ *
+ * A worker that fails mid-shard drops its connection; the coordinator puts
+ * the shard back in the pending pool and another worker picks it up. Hung,
+ * stopped or partitioned workers are caught by socket timeouts and
+ * keepalives and handled the same way. A link never gets a shard back that
+ * its own worker already failed, and a shard is only abandoned once every
+ * link still running has failed it.
+ */
+
+enum { SHARD_RANGE = 1, SHARD_NUMBERS = 2, SHARD_SEED = 3 };
+enum { SHARD_PENDING, SHARD_ASSIGNED, SHARD_DONE, SHARD_FAILED };
+
+#define REQUEST_WORDS 5
+#define REPLY_WORDS 2
+
+int sendAll(int fd, const void *buf, size_t len) {
+    const char *p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int recvAll(int fd, void *buf, size_t len) {
+    char *p = (char*)buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int sendWords(int fd, const uint64_t *words, int count) {
+    uint64_t wire[REQUEST_WORDS];
+    for (int i = 0; i < count; i++) {
+        wire[i] = htobe64(words[i]);
+    }
+    return sendAll(fd, wire, count * sizeof(uint64_t));
+}
+
+int recvWords(int fd, uint64_t *words, int count) {
+    if (recvAll(fd, words, count * sizeof(uint64_t)) != 0) return -1;
+    for (int i = 0; i < count; i++) {
+        words[i] = be64toh(words[i]);
+    }
+    return 0;
+}
+
+long cpuCount() {
+    long numCPU = sysconf(_SC_NPROCESSORS_ONLN);
+    return numCPU < 1 ? 1 : numCPU; // Fallback to at least one thread if detection fails
+}
+
+// State shared by the threads that count one shard on a worker
+typedef struct {
+    const int *values;
+    size_t numValues;
+    uint64_t lo, hi;
+    const uint32_t *primes;
+    size_t numPrimes;
+    atomic_ullong next;
+    atomic_ullong primesFound;
+} ShardTask;
+
+// Worker thread function: claims chunks of the shard's numbers and tests them
+void* valuesWorker(void *arg) {
+    ShardTask *task = (ShardTask*)arg;
+    unsigned long long start;
+    while ((start = atomic_fetch_add(&task->next, VALUES_CHUNK)) < task->numValues) {
+        size_t end = start + VALUES_CHUNK < task->numValues ? start + VALUES_CHUNK : task->numValues;
+        unsigned long long found = 0;
+        for (size_t i = start; i < end; i++) {
+            if (isPrime(task->values[i])) found++;
+        }
+        atomic_fetch_add(&task->primesFound, found);
+    }
+    return NULL;
+}
+
+// Worker thread function: claims segments of the shard's range and sieves them
+void* rangeWorker(void *arg) {
+    ShardTask *task = (ShardTask*)arg;
+    uint64_t *scratch = (uint64_t*)malloc((sieveWords(0, RANGE_SEGMENT_SPAN) + 1) * sizeof(uint64_t));
+    if (!scratch) {
+        fprintf(stderr, "Failed to allocate memory for sieve segment.\n");
+        exit(EXIT_FAILURE);
+    }
+    unsigned long long offset;
+    while ((offset = atomic_fetch_add(&task->next, RANGE_SEGMENT_SPAN)) < task->hi - task->lo) {
+        uint64_t a = task->lo + offset;
+        uint64_t b = a + RANGE_SEGMENT_SPAN < task->hi ? a + RANGE_SEGMENT_SPAN : task->hi;
+        atomic_fetch_add(&task->primesFound, sieveCount(a, b, task->primes, task->numPrimes, scratch));
+    }
+    free(scratch);
+    return NULL;
+}
+
+uint64_t runShardTask(ShardTask *task, void *(*fn)(void*)) {
+    atomic_init(&task->next, 0);
+    atomic_init(&task->primesFound, 0);
+
+    long numCPU = cpuCount();
+    pthread_t *threads = (pthread_t*)malloc(numCPU * sizeof(pthread_t));
+    if (!threads) {
+        fprintf(stderr, "Failed to allocate memory for threads.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < numCPU; i++) {
+        if (pthread_create(&threads[i], NULL, fn, task) != 0) {
+            fprintf(stderr, "Failed to create thread %ld.\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (long i = 0; i < numCPU; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return atomic_load(&task->primesFound);
+}
+
+/*
+ * Reentrant copy of the generator behind rand(). initstate_r with a
+ * SEED_STATE_BYTES buffer gives the same stream as srand()/rand(), and unlike
+ * rand() its state can be snapshotted, so the coordinator walks the stream
+ * once and each shard resumes exactly where the previous one ended.
+ */
+typedef struct {
+    int32_t buf[SEED_STATE_BYTES / sizeof(int32_t)];
+    struct random_data data;
+} SeedGenerator;
+
+void initSeedGenerator(SeedGenerator *gen, int seed) {
+    memset(gen, 0, sizeof(*gen));
+    initstate_r((unsigned int)seed, (char*)gen->buf, SEED_STATE_BYTES, &gen->data);
+}
+
+// Same formula and limits as generator.c, so seed shards match `randomGenerator <seed> <count>`
+int nextSeedValue(SeedGenerator *gen) {
+    int lowerLimit = 1000000;
+    int upperLimit = 2100000000;
+    int32_t r;
+    random_r(&gen->data, &r);
+    return r % (upperLimit - lowerLimit + 1) + lowerLimit;
+}
+
+// Generates count numbers from a generator state captured by the coordinator
+int* generateSeedValues(const char *state, uint64_t frontOffset, uint64_t rearOffset, uint64_t count) {
+    SeedGenerator gen;
+    initSeedGenerator(&gen, 1);
+    if (frontOffset >= (uint64_t)gen.data.rand_deg || rearOffset >= (uint64_t)gen.data.rand_deg) return NULL;
+
+    for (size_t w = 0; w < SEED_STATE_BYTES / sizeof(int32_t); w++) {
+        uint32_t word;
+        memcpy(&word, state + 4 * w, sizeof(word));
+        gen.buf[w] = (int32_t)be32toh(word);
+    }
+    gen.data.fptr = gen.data.state + frontOffset;
+    gen.data.rptr = gen.data.state + rearOffset;
+
+    int *values = (int*)malloc((count ? count : 1) * sizeof(int));
+    if (!values) return NULL;
+    for (uint64_t i = 0; i < count; i++) {
+        values[i] = nextSeedValue(&gen);
+    }
+    return values;
+}
+
+int* parseValues(char *text, size_t len, size_t *count) {
+    // Every number takes at least two bytes including its separator
+    int *values = (int*)malloc((len / 2 + 1) * sizeof(int));
+    if (!values) return NULL;
+
+    size_t n = 0;
+    char *p = text;
+    char *end = text + len;
+    while (p < end) {
+        char *next;
+        long v = strtol(p, &next, 10);
+        if (next == p) {
+            p++; // Skip separators and stray bytes
+            continue;
+        }
+        values[n++] = (int)v;
+        p = next;
+    }
+    *count = n;
+    return values;
+}
+
+/*
+ * Runs one shard request on this worker. Returns 0 and fills the reply,
+ * or -1 when the request is malformed.
+ */
+int processShard(const uint64_t *request, char *payload, const uint32_t *primes, size_t numPrimes, uint64_t *reply) {
+    ShardTask task;
+    memset(&task, 0, sizeof(task));
+
+    switch (request[0]) {
+        case SHARD_RANGE:
+            if (request[1] > request[2] || request[2] > (1ULL << 32)) return -1;
+            task.lo = request[1];
+            task.hi = request[2];
+            task.primes = primes;
+            task.numPrimes = numPrimes;
+            reply[0] = runShardTask(&task, rangeWorker);
+            reply[1] = task.hi - task.lo;
+            return 0;
+        case SHARD_SEED: {
+            if (request[4] != SEED_STATE_BYTES) return -1;
+            int *values = generateSeedValues(payload, request[1], request[2], request[3]);
+            if (!values) return -1;
+            task.values = values;
+            task.numValues = request[3];
+            reply[0] = runShardTask(&task, valuesWorker);
+            reply[1] = task.numValues;
+            free(values);
+            return 0;
+        }
+        case SHARD_NUMBERS: {
+            size_t count;
+            int *values = parseValues(payload, request[4], &count);
+            if (!values) return -1;
+            task.values = values;
+            task.numValues = count;
+            reply[0] = runShardTask(&task, valuesWorker);
+            reply[1] = count;
+            free(values);
+            return 0;
+        }
+        default:
+            return -1;
+    }
+}
+
+void serveCoordinator(int fd, const uint32_t *primes, size_t numPrimes) {
+    uint64_t request[REQUEST_WORDS];
+    while (recvWords(fd, request, REQUEST_WORDS) == 0) {
+        if (request[4] > MAX_PAYLOAD_SIZE) return;
+        char *payload = (char*)malloc(request[4] + 1);
+        if (!payload) return;
+        if (recvAll(fd, payload, request[4]) != 0) {
+            free(payload);
+            return;
+        }
+        payload[request[4]] = '\0';
+
+        uint64_t reply[REPLY_WORDS];
+        int status = processShard(request, payload, primes, numPrimes, reply);
+        free(payload);
+        if (status != 0 || sendWords(fd, reply, REPLY_WORDS) != 0) return;
+    }
+}
+
+// Worker mode: serve shards from one coordinator connection at a time, forever
+int runWorker(const char *port) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET6;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int rc = getaddrinfo(NULL, port, &hints, &res);
+    if (rc != 0) {
+        hints.ai_family = AF_INET;
+        rc = getaddrinfo(NULL, port, &hints, &res);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Invalid port %s: %s\n", port, gai_strerror(rc));
+        return 1;
+    }
+
+    int listenFd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    int yes = 1;
+    int no = 0;
+    if (listenFd >= 0) {
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if (res->ai_family == AF_INET6) {
+            setsockopt(listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no)); // Accept IPv4 too
+        }
+    }
+    if (listenFd < 0 || bind(listenFd, res->ai_addr, res->ai_addrlen) != 0 || listen(listenFd, 16) != 0) {
+        perror("Failed to listen");
+        freeaddrinfo(res);
+        return 1;
+    }
+    freeaddrinfo(res);
+
+    size_t numPrimes;
+    uint32_t *primes = sieveBasePrimes(SIEVE_BASE_LIMIT, &numPrimes);
+    fprintf(stderr, "Worker listening on port %s.\n", port);
+
+    while (1) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        serveCoordinator(fd, primes, numPrimes);
+        close(fd);
+    }
+
+    free(primes);
+    close(listenFd);
+    return 1;
+}
+
+typedef struct {
+    uint32_t type;
+    uint64_t arg[3]; // RANGE: lo, hi; SEED: front offset, rear offset, count; NUMBERS: file offset, length
+    char *seedState; // SEED: generator state at the start of the shard, in wire format
+    int state;
+    int *failedBy; // Links whose worker already failed this shard
+    int numFailedBy;
+} Shard;
+
+typedef struct {
+    Shard *shards;
+    size_t numShards;
+    size_t capacity;
+    size_t settled; // Shards that are done or abandoned
+    size_t *pending; // Ring of pending shard indices, numShards slots
+    size_t pendingHead;
+    size_t pendingCount;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint64_t totalPrimes;
+    uint64_t totalInputs;
+    uint64_t reissued;
+    int fileFd;
+    int shardTimeoutMs;
+    int *linkRunning; // linkRunning[id] is cleared when that link's thread gives up
+    int runningLinks;
+} Coordinator;
+
+// One connection from the coordinator to a worker, driven by its own thread
+typedef struct {
+    Coordinator *coord;
+    int id;
+    char host[256];
+    char port[32];
+    uint64_t shardsDone;
+    uint64_t inputsDone;
+    uint64_t failures;
+    int consecutiveFailures;
+    int alive;
+} WorkerLink;
+
+void addShard(Coordinator *coord, uint32_t type, uint64_t a0, uint64_t a1, uint64_t a2) {
+    if (coord->numShards == coord->capacity) {
+        coord->capacity = coord->capacity ? coord->capacity * 2 : 64;
+        coord->shards = (Shard*)realloc(coord->shards, coord->capacity * sizeof(Shard));
+        if (!coord->shards) {
+            fprintf(stderr, "Failed to allocate memory for shards.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    Shard *shard = &coord->shards[coord->numShards++];
+    shard->type = type;
+    shard->arg[0] = a0;
+    shard->arg[1] = a1;
+    shard->arg[2] = a2;
+    shard->seedState = NULL;
+    shard->state = SHARD_PENDING;
+    shard->failedBy = NULL;
+    shard->numFailedBy = 0;
+}
+
+// Splits the corpus file at line boundaries, shardSize lines per shard
+int addFileShards(Coordinator *coord, const char *path, uint64_t shardSize) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+    char buf[1 << 16];
+    uint64_t offset = 0, shardStart = 0, lines = 0;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            if (buf[i] == '\n' && ++lines == shardSize) {
+                addShard(coord, SHARD_NUMBERS, shardStart, offset + i + 1 - shardStart, 0);
+                shardStart = offset + i + 1;
+                lines = 0;
+            }
+        }
+        offset += n;
+    }
+    fclose(in);
+    if (offset > shardStart) {
+        addShard(coord, SHARD_NUMBERS, shardStart, offset - shardStart, 0);
+    }
+
+    coord->fileFd = open(path, O_RDONLY);
+    if (coord->fileFd < 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+bool shardFailedBy(const Shard *shard, int linkId) {
+    for (int i = 0; i < shard->numFailedBy; i++) {
+        if (shard->failedBy[i] == linkId) return true;
+    }
+    return false;
+}
+
+// A shard is only given up once every link still running has failed it
+bool shardHopeless(const Coordinator *coord, const Shard *shard) {
+    int running = 0;
+    for (int i = 0; i < shard->numFailedBy; i++) {
+        if (coord->linkRunning[shard->failedBy[i]]) running++;
+    }
+    return running >= coord->runningLinks;
+}
+
+// Queues every shard; call once all shards are added
+void initPending(Coordinator *coord) {
+    coord->pending = (size_t*)malloc((coord->numShards ? coord->numShards : 1) * sizeof(size_t));
+    if (!coord->pending) {
+        fprintf(stderr, "Failed to allocate memory for shards.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < coord->numShards; i++) {
+        coord->pending[i] = i;
+    }
+    coord->pendingHead = 0;
+    coord->pendingCount = coord->numShards;
+}
+
+size_t* pendingAt(Coordinator *coord, size_t j) {
+    return &coord->pending[(coord->pendingHead + j) % coord->numShards];
+}
+
+void pushPending(Coordinator *coord, size_t idx) {
+    *pendingAt(coord, coord->pendingCount++) = idx;
+}
+
+// Returns the index of a shard now assigned to the calling link, or -1 when nothing is left for it
+long claimShard(Coordinator *coord, int linkId) {
+    pthread_mutex_lock(&coord->lock);
+    while (coord->settled < coord->numShards) {
+        // Only shards this link already failed are skipped, so this is normally the head
+        for (size_t j = 0; j < coord->pendingCount; j++) {
+            size_t idx = *pendingAt(coord, j);
+            if (!shardFailedBy(&coord->shards[idx], linkId)) {
+                *pendingAt(coord, j) = *pendingAt(coord, 0);
+                coord->pendingHead = (coord->pendingHead + 1) % coord->numShards;
+                coord->pendingCount--;
+                coord->shards[idx].state = SHARD_ASSIGNED;
+                pthread_mutex_unlock(&coord->lock);
+                return (long)idx;
+            }
+        }
+        // Everything left is in flight elsewhere or already failed here; wait in case that changes
+        pthread_cond_wait(&coord->changed, &coord->lock);
+    }
+    pthread_mutex_unlock(&coord->lock);
+    return -1;
+}
+
+void completeShard(Coordinator *coord, long idx, const uint64_t *reply) {
+    pthread_mutex_lock(&coord->lock);
+    coord->shards[idx].state = SHARD_DONE;
+    coord->settled++;
+    coord->totalPrimes += reply[0];
+    coord->totalInputs += reply[1];
+    pthread_cond_broadcast(&coord->changed);
+    pthread_mutex_unlock(&coord->lock);
+}
+
+// Puts a shard whose worker failed back into the pool for the other links, or abandons it
+void releaseShard(Coordinator *coord, int linkId, long idx) {
+    pthread_mutex_lock(&coord->lock);
+    Shard *shard = &coord->shards[idx];
+    shard->failedBy = (int*)realloc(shard->failedBy, (shard->numFailedBy + 1) * sizeof(int));
+    if (!shard->failedBy) {
+        fprintf(stderr, "Failed to allocate memory for shards.\n");
+        exit(EXIT_FAILURE);
+    }
+    shard->failedBy[shard->numFailedBy++] = linkId;
+    if (shardHopeless(coord, shard)) {
+        shard->state = SHARD_FAILED;
+        coord->settled++;
+    } else {
+        shard->state = SHARD_PENDING;
+        pushPending(coord, (size_t)idx);
+        coord->reissued++;
+    }
+    pthread_cond_broadcast(&coord->changed);
+    pthread_mutex_unlock(&coord->lock);
+}
+
+// Called when a link's thread stops; shards only it could still take become hopeless
+void linkExited(Coordinator *coord, int linkId) {
+    pthread_mutex_lock(&coord->lock);
+    coord->linkRunning[linkId] = 0;
+    coord->runningLinks--;
+    size_t kept = 0;
+    for (size_t j = 0; j < coord->pendingCount; j++) {
+        size_t idx = *pendingAt(coord, j);
+        Shard *shard = &coord->shards[idx];
+        if (shardHopeless(coord, shard)) {
+            shard->state = SHARD_FAILED;
+            coord->settled++;
+        } else {
+            *pendingAt(coord, kept++) = idx;
+        }
+    }
+    coord->pendingCount = kept;
+    pthread_cond_broadcast(&coord->changed);
+    pthread_mutex_unlock(&coord->lock);
+}
+
+// Walks the seed stream once, snapshotting the generator at every shard boundary
+void addSeedShards(Coordinator *coord, int seed, uint64_t count, uint64_t shardSize) {
+    SeedGenerator gen;
+    initSeedGenerator(&gen, seed);
+    for (uint64_t offset = 0; offset < count; offset += shardSize) {
+        uint64_t n = offset + shardSize < count ? shardSize : count - offset;
+        addShard(coord, SHARD_SEED, (uint64_t)(gen.data.fptr - gen.data.state),
+                 (uint64_t)(gen.data.rptr - gen.data.state), n);
+
+        char *state = (char*)malloc(SEED_STATE_BYTES);
+        if (!state) {
+            fprintf(stderr, "Failed to allocate memory for shards.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t w = 0; w < SEED_STATE_BYTES / sizeof(int32_t); w++) {
+            uint32_t word = htobe32((uint32_t)gen.buf[w]);
+            memcpy(state + 4 * w, &word, sizeof(word));
+        }
+        coord->shards[coord->numShards - 1].seedState = state;
+
+        for (uint64_t i = 0; i < n; i++) {
+            int32_t r;
+            random_r(&gen.data, &r);
+        }
+    }
+}
+
+// connect() with a timeout; the socket is left blocking
+int connectWithTimeout(int fd, const struct sockaddr *addr, socklen_t len, int timeoutMs) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) return -1;
+
+    int rc = connect(fd, addr, len);
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        int err = 0;
+        socklen_t errLen = sizeof(err);
+        rc = -1;
+        if (poll(&pfd, 1, timeoutMs) == 1
+            && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) == 0 && err == 0) {
+            rc = 0;
+        }
+    }
+    if (rc != 0 || fcntl(fd, F_SETFL, flags) != 0) return -1;
+    return 0;
+}
+
+int connectWorker(WorkerLink *link) {
+    struct timeval timeout = {link->coord->shardTimeoutMs / 1000, (link->coord->shardTimeoutMs % 1000) * 1000};
+    int yes = 1;
+
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; attempt++) {
+        if (attempt > 0) sleep(1);
+
+        struct addrinfo hints, *res, *ai;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(link->host, link->port, &hints, &res) != 0) continue;
+        for (ai = res; ai; ai = ai->ai_next) {
+            int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) continue;
+            if (connectWithTimeout(fd, ai->ai_addr, ai->ai_addrlen, CONNECT_TIMEOUT_MS) == 0) {
+                // A request is a header and a payload write; don't let Nagle hold the second one back
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+                // A worker that stops answering times out like one that drops the connection
+                setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof(yes));
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                freeaddrinfo(res);
+                return fd;
+            }
+            close(fd);
+        }
+        freeaddrinfo(res);
+    }
+    return -1;
+}
+
+int sendShard(Coordinator *coord, int fd, const Shard *shard) {
+    uint64_t request[REQUEST_WORDS] = {shard->type, shard->arg[0], shard->arg[1], shard->arg[2], 0};
+    if (shard->type == SHARD_SEED) {
+        request[4] = SEED_STATE_BYTES;
+        return sendWords(fd, request, REQUEST_WORDS) == 0 && sendAll(fd, shard->seedState, SEED_STATE_BYTES) == 0 ? 0 : -1;
+    }
+    if (shard->type != SHARD_NUMBERS) {
+        return sendWords(fd, request, REQUEST_WORDS);
+    }
+
+    // Corpus shards are re-read from the file on every attempt instead of being kept in memory
+    uint64_t length = shard->arg[1];
+    char *payload = (char*)malloc(length ? length : 1);
+    if (!payload) return -1;
+    if (pread(coord->fileFd, payload, length, (off_t)shard->arg[0]) != (ssize_t)length) {
+        free(payload);
+        return -1;
+    }
+    request[1] = request[2] = 0;
+    request[4] = length;
+    int status = sendWords(fd, request, REQUEST_WORDS) == 0 && sendAll(fd, payload, length) == 0 ? 0 : -1;
+    free(payload);
+    return status;
+}
+
+void* linkThread(void *arg) {
+    WorkerLink *link = (WorkerLink*)arg;
+    Coordinator *coord = link->coord;
+    int fd = -1;
+
+    while (1) {
+        if (fd < 0 && (fd = connectWorker(link)) < 0) break;
+        long idx = claimShard(coord, link->id);
+        if (idx < 0) break;
+
+        uint64_t reply[REPLY_WORDS];
+        if (sendShard(coord, fd, &coord->shards[idx]) != 0 || recvWords(fd, reply, REPLY_WORDS) != 0) {
+            fprintf(stderr, "Worker %s:%s failed or timed out on shard %ld; re-issuing it.\n", link->host, link->port, idx);
+            close(fd);
+            fd = -1;
+            link->failures++;
+            releaseShard(coord, link->id, idx);
+            // Reconnecting to a stopped worker succeeds, so give up on one that keeps failing
+            if (++link->consecutiveFailures >= CONNECT_ATTEMPTS) break;
+            continue;
+        }
+        link->consecutiveFailures = 0;
+        completeShard(coord, idx, reply);
+        link->shardsDone++;
+        link->inputsDone += reply[1];
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    } else {
+        link->alive = 0;
+        fprintf(stderr, "Worker %s:%s is unreachable or unresponsive.\n", link->host, link->port);
+    }
+    linkExited(coord, link->id);
+    return NULL;
+}
+
+int parseWorkerList(char *list, WorkerLink **links, Coordinator *coord) {
+    int count = 1;
+    for (char *p = list; *p; p++) {
+        if (*p == ',') count++;
+    }
+    *links = (WorkerLink*)calloc(count, sizeof(WorkerLink));
+    if (!*links) {
+        fprintf(stderr, "Failed to allocate memory for workers.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int n = 0;
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ",")) {
+        char *colon = strrchr(item, ':');
+        if (!colon || colon == item || colon[1] == '\0'
+            || (size_t)(colon - item) >= sizeof((*links)->host) || strlen(colon + 1) >= sizeof((*links)->port)) {
+            fprintf(stderr, "Worker address must be host:port: %s\n", item);
+            return -1;
+        }
+        WorkerLink *link = &(*links)[n++];
+        memcpy(link->host, item, colon - item);
+        strcpy(link->port, colon + 1);
+        link->coord = coord;
+        link->id = n - 1;
+        link->alive = 1;
+    }
+    return n;
+}
+
+int parseCount(const char *text, uint64_t max, uint64_t *value) {
+    char *end;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (*text == '\0' || *text == '-' || *end != '\0' || v > max) {
+        fprintf(stderr, "Expected an integer in [0, %llu]: %s\n", (unsigned long long)max, text);
+        return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+double elapsedSeconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Coordinator mode:
+ *   --coordinator <host:port>[,...] [--shard-size N] [--shard-timeout ms] --range <a> <b> | --file <path> | --seed <seed> <count>
+ */
+int runCoordinator(int argc, char *argv[]) {
+    Coordinator coord;
+    memset(&coord, 0, sizeof(coord));
+    coord.fileFd = -1;
+    coord.shardTimeoutMs = DEFAULT_SHARD_TIMEOUT_MS;
+    pthread_mutex_init(&coord.lock, NULL);
+    pthread_cond_init(&coord.changed, NULL);
+
+    WorkerLink *links;
+    int numLinks = parseWorkerList(argv[0], &links, &coord);
+    if (numLinks <= 0) return 1;
+    coord.linkRunning = (int*)malloc(numLinks * sizeof(int));
+    if (!coord.linkRunning) {
+        fprintf(stderr, "Failed to allocate memory for workers.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int w = 0; w < numLinks; w++) {
+        coord.linkRunning[w] = 1;
+    }
+    coord.runningLinks = numLinks;
+
+    uint64_t shardSize = DEFAULT_SHARD_SIZE;
+    int i = 1;
+    while (i + 1 < argc) {
+        if (strcmp(argv[i], "--shard-size") == 0) {
+            if (parseCount(argv[i + 1], UINT32_MAX, &shardSize) != 0 || shardSize == 0) return 1;
+        } else if (strcmp(argv[i], "--shard-timeout") == 0) {
+            uint64_t timeoutMs;
+            if (parseCount(argv[i + 1], INT32_MAX, &timeoutMs) != 0 || timeoutMs == 0) return 1;
+            coord.shardTimeoutMs = (int)timeoutMs;
+        } else {
+            break;
+        }
+        i += 2;
+    }
+
+    if (i + 2 < argc && strcmp(argv[i], "--range") == 0 && i + 3 == argc) {
+        uint64_t a, b;
+        if (parseCount(argv[i + 1], UINT32_MAX, &a) != 0 || parseCount(argv[i + 2], UINT32_MAX, &b) != 0) return 1;
+        for (uint64_t lo = a; lo <= b; lo += shardSize) {
+            addShard(&coord, SHARD_RANGE, lo, lo + shardSize < b + 1 ? lo + shardSize : b + 1, 0);
+        }
+    } else if (i + 1 < argc && strcmp(argv[i], "--file") == 0 && i + 2 == argc) {
+        if (addFileShards(&coord, argv[i + 1], shardSize) != 0) return 1;
+    } else if (i + 2 < argc && strcmp(argv[i], "--seed") == 0 && i + 3 == argc) {
+        uint64_t count;
+        int seed = atoi(argv[i + 1]);
+        if (parseCount(argv[i + 2], INT32_MAX, &count) != 0) return 1;
+        addSeedShards(&coord, seed, count, shardSize);
+    } else {
+        fprintf(stderr, "Coordinator needs exactly one of --range <a> <b>, --file <path>, --seed <seed> <count>.\n");
+        return 1;
+    }
+
+    initPending(&coord);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t *threads = (pthread_t*)malloc(numLinks * sizeof(pthread_t));
+    if (!threads) {
+        fprintf(stderr, "Failed to allocate memory for threads.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int w = 0; w < numLinks; w++) {
+        if (pthread_create(&threads[w], NULL, linkThread, &links[w]) != 0) {
+            fprintf(stderr, "Failed to create thread %d.\n", w);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int w = 0; w < numLinks; w++) {
+        pthread_join(threads[w], NULL);
+    }
+
+    size_t done = 0;
+    for (size_t s = 0; s < coord.numShards; s++) {
+        if (coord.shards[s].state == SHARD_DONE) done++;
+    }
+
+    printf("%llu total primes.\n", (unsigned long long)coord.totalPrimes);
+    fprintf(stderr, "Covered %llu inputs in %zu of %zu shards (%llu re-issued) in %.3f s.\n",
+            (unsigned long long)coord.totalInputs, done, coord.numShards,
+            (unsigned long long)coord.reissued, elapsedSeconds(&start));
+    for (int w = 0; w < numLinks; w++) {
+        fprintf(stderr, "  worker %s:%s: %llu shards, %llu inputs, %llu failures%s\n",
+                links[w].host, links[w].port,
+                (unsigned long long)links[w].shardsDone, (unsigned long long)links[w].inputsDone,
+                (unsigned long long)links[w].failures, links[w].alive ? "" : " (unreachable)");
+    }
+
+    int status = 0;
+    if (done < coord.numShards) {
+        fprintf(stderr, "%zu shards could not be processed; the count is incomplete.\n", coord.numShards - done);
+        status = 1;
+    }
+
+    if (coord.fileFd >= 0) close(coord.fileFd);
+    for (size_t s = 0; s < coord.numShards; s++) {
+        free(coord.shards[s].seedState);
+        free(coord.shards[s].failedBy);
+    }
+    free(coord.shards);
+    free(coord.pending);
+    free(coord.linkRunning);
+    free(links);
+    free(threads);
+    return status;
+}
+
+/*
+ * Prime Emission
+ *
+ * Threads claim segments of the range in order, sieve each one, compact its
+ * bitmap into a packed array of primes and format that as text in a private
+ * buffer. Buffers are written to stdout strictly in segment order, so the
+ * output is sorted while sieving and formatting run in parallel.
+ */
+typedef struct {
+    uint64_t a, b; // Emit the primes in [a, b)
+    const uint32_t *primes;
+    size_t numPrimes;
+    atomic_ullong nextSegment;
+    uint64_t nextToWrite;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    atomic_ullong emitted;
+    atomic_bool writeFailed;
+} EmitState;
+
+int writeAll(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+void* emitWorker(void *arg) {
+    EmitState *state = (EmitState*)arg;
+    size_t words = sieveWords(0, RANGE_SEGMENT_SPAN) + 1;
+    size_t maxPrimes = words * 64 + 1;
+    uint64_t *bits = (uint64_t*)malloc(words * sizeof(uint64_t));
+    uint32_t *packed = (uint32_t*)malloc((maxPrimes + COMPACT_SLACK) * sizeof(uint32_t));
+    char *text = (char*)malloc(maxPrimes * DECIMAL_LINE_MAX + FORMAT_SLACK);
+    if (!bits || !packed || !text) {
+        fprintf(stderr, "Failed to allocate memory for emission buffers.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned long long k;
+    uint64_t numSegments = (state->b - state->a + RANGE_SEGMENT_SPAN - 1) / RANGE_SEGMENT_SPAN;
+    while ((k = atomic_fetch_add(&state->nextSegment, 1)) < numSegments) {
+        uint64_t segA = state->a + k * RANGE_SEGMENT_SPAN;
+        uint64_t segB = segA + RANGE_SEGMENT_SPAN < state->b ? segA + RANGE_SEGMENT_SPAN : state->b;
+        uint64_t lo = segA & ~1ULL;
+
+        size_t n = 0;
+        if (segA <= 2 && segB > 2) {
+            packed[n++] = 2; // The odd-only bitmap has no bit for 2
+        }
+        sieveSegment(lo, segB, state->primes, state->numPrimes, bits);
+        n += compactPrimes(lo, bits, sieveWords(lo, segB), packed + n);
+        size_t len = formatDecimal(packed, n, text);
+
+        pthread_mutex_lock(&state->lock);
+        while (state->nextToWrite != k) {
+            pthread_cond_wait(&state->turn, &state->lock);
+        }
+        pthread_mutex_unlock(&state->lock);
+
+        if (!atomic_load(&state->writeFailed) && writeAll(STDOUT_FILENO, text, len) != 0) {
+            atomic_store(&state->writeFailed, true);
+        }
+        atomic_fetch_add(&state->emitted, n);
+
+        pthread_mutex_lock(&state->lock);
+        state->nextToWrite++;
+        pthread_cond_broadcast(&state->turn);
+        pthread_mutex_unlock(&state->lock);
+    }
+
+    free(bits);
+    free(packed);
+    free(text);
+    return NULL;
+}
+
+// Emit mode: print every prime in [a, b] on its own line, then the count on stderr
+int runEmitter(uint64_t a, uint64_t b) {
+    initEmit();
+
+    EmitState state;
+    memset(&state, 0, sizeof(state));
+    state.a = a;
+    state.b = b + 1;
+    state.primes = sieveBasePrimes(SIEVE_BASE_LIMIT, &state.numPrimes);
+    atomic_init(&state.nextSegment, 0);
+    atomic_init(&state.emitted, 0);
+    atomic_init(&state.writeFailed, false);
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.turn, NULL);
+
+    long numCPU = cpuCount();
+    pthread_t *threads = (pthread_t*)malloc(numCPU * sizeof(pthread_t));
+    if (!threads) {
+        fprintf(stderr, "Failed to allocate memory for threads.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < numCPU; i++) {
+        if (pthread_create(&threads[i], NULL, emitWorker, &state) != 0) {
+            fprintf(stderr, "Failed to create thread %ld.\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (long i = 0; i < numCPU; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int status = 0;
+    if (atomic_load(&state.writeFailed)) {
+        fprintf(stderr, "Failed to write primes to stdout.\n");
+        status = 1;
+    } else {
+        fprintf(stderr, "%llu total primes.\n", atomic_load(&state.emitted));
+    }
+
+    free((void*)state.primes);
+    free(threads);
+    return status;
+}
+
+/*
+ * Residue Class Counts
+ *
+ * One segmented sieve pass over [a, b] counts the primes in every residue
+ * class mod q at once. Segments start at multiples of RANGE_SEGMENT_SPAN so
+ * each bitmap word has a known phase mod q, and each thread keeps its own
+ * per-class counters until the end.
+ */
+typedef struct {
+    uint64_t a, b; // Count the primes in [a, b)
+    uint64_t start; // a rounded down to a segment boundary
+    const uint32_t *primes;
+    size_t numPrimes;
+    const ResidueClasses *classes;
+    atomic_ullong nextSegment;
+    pthread_mutex_t lock;
+    uint64_t *counts;
+} ResidueState;
+
+void* residueWorker(void *arg) {
+    ResidueState *state = (ResidueState*)arg;
+    uint64_t *bits = (uint64_t*)malloc(sieveWords(0, RANGE_SEGMENT_SPAN) * sizeof(uint64_t));
+    uint64_t *counts = (uint64_t*)calloc(state->classes->stride, sizeof(uint64_t));
+    if (!bits || !counts) {
+        fprintf(stderr, "Failed to allocate memory for residue counts.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned long long k;
+    uint64_t numSegments = (state->b - state->start + RANGE_SEGMENT_SPAN - 1) / RANGE_SEGMENT_SPAN;
+    while ((k = atomic_fetch_add(&state->nextSegment, 1)) < numSegments) {
+        uint64_t lo = state->start + k * RANGE_SEGMENT_SPAN;
+        uint64_t hi = lo + RANGE_SEGMENT_SPAN < state->b ? lo + RANGE_SEGMENT_SPAN : state->b;
+        sieveSegment(lo, hi, state->primes, state->numPrimes, bits);
+
+        // The first segment may start below a: drop the odd numbers in [lo, a)
+        if (lo < state->a) {
+            uint64_t skip = (state->a - lo) / 2;
+            memset(bits, 0, (skip / 64) * sizeof(uint64_t));
+            if (skip % 64) {
+                bits[skip / 64] &= ~((1ULL << (skip % 64)) - 1);
+            }
+        }
+        countResidues(state->classes, lo, bits, sieveWords(lo, hi), counts);
+    }
+
+    pthread_mutex_lock(&state->lock);
+    for (size_t c = 0; c < state->classes->numClasses; c++) {
+        state->counts[c] += counts[c];
+    }
+    pthread_mutex_unlock(&state->lock);
+
+    free(bits);
+    free(counts);
+    return NULL;
+}
+
+// Residue mode: print pi(x; q, r) for [a, b] and every class r mod q that holds a prime
+int runResidueCounter(uint32_t q, uint64_t a, uint64_t b) {
+    ResidueClasses classes;
+    initResidueClasses(&classes, q);
+
+    ResidueState state;
+    memset(&state, 0, sizeof(state));
+    state.a = a;
+    state.b = b + 1;
+    state.start = a / RANGE_SEGMENT_SPAN * RANGE_SEGMENT_SPAN;
+    state.primes = sieveBasePrimes(SIEVE_BASE_LIMIT, &state.numPrimes);
+    state.classes = &classes;
+    state.counts = (uint64_t*)calloc(classes.stride, sizeof(uint64_t));
+    uint64_t *byResidue = (uint64_t*)calloc(q, sizeof(uint64_t));
+    if (!state.counts || !byResidue) {
+        fprintf(stderr, "Failed to allocate memory for residue counts.\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&state.nextSegment, 0);
+    pthread_mutex_init(&state.lock, NULL);
+
+    long numCPU = cpuCount();
+    pthread_t *threads = (pthread_t*)malloc(numCPU * sizeof(pthread_t));
+    if (!threads) {
+        fprintf(stderr, "Failed to allocate memory for threads.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < numCPU; i++) {
+        if (pthread_create(&threads[i], NULL, residueWorker, &state) != 0) {
+            fprintf(stderr, "Failed to create thread %ld.\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (long i = 0; i < numCPU; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (size_t c = 0; c < classes.numClasses; c++) {
+        byResidue[classes.residues[c]] = state.counts[c];
+    }
+    // The bitmap has no bit for 2, and odd primes dividing q are left out of the classes
+    if (a <= 2 && 2 <= b) {
+        byResidue[2 % q]++;
+    }
+    uint32_t rest = q;
+    for (uint32_t p = 2; p * p <= rest; p++) {
+        if (rest % p != 0) continue;
+        while (rest % p == 0) rest /= p;
+        if (p != 2 && a <= p && p <= b) byResidue[p % q]++;
+    }
+    if (rest > 2 && a <= rest && rest <= b) {
+        byResidue[rest % q]++;
+    }
+
+    uint64_t total = 0;
+    printf("Primes in [%llu, %llu] by residue class mod %u:\n",
+           (unsigned long long)a, (unsigned long long)b, q);
+    for (uint32_t r = 0; r < q; r++) {
+        total += byResidue[r];
+        if (byResidue[r] > 0 || classes.classOf[r] >= 0) {
+            printf("  %u mod %u: %llu primes\n", r, q, (unsigned long long)byResidue[r]);
+        }
+    }
+    printf("%llu total primes.\n", (unsigned long long)total);
+
+    free((void*)state.primes);
+    free(state.counts);
+    free(byResidue);
+    free(threads);
+    freeResidueClasses(&classes);
     return 0;
 }
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--deadline <ms>]     (count primes read from stdin)\n", prog);
+    fprintf(stderr, "       %s --primes <a> <b>           (print every prime in [a, b])\n", prog);
+    fprintf(stderr, "       %s --residues <q> <a> <b>     (count primes in [a, b] per class mod q)\n", prog);
+    fprintf(stderr, "       %s --worker <port>\n", prog);
+    fprintf(stderr, "       %s --coordinator <host:port>[,...] [--shard-size N] [--shard-timeout ms]\n", prog);
+    fprintf(stderr, "           (--range <a> <b> | --file <path> | --seed <seed> <count>)\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 1) {
+        return runStreamCounter(0);
+    }
+    if (argc == 3 && strcmp(argv[1], "--deadline") == 0) {
+        uint64_t deadlineMs;
+        if (parseCount(argv[2], INT32_MAX, &deadlineMs) != 0 || deadlineMs == 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runStreamCounter((long)deadlineMs);
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--primes") == 0) {
+        uint64_t a, b;
+        if (parseCount(argv[2], UINT32_MAX, &a) != 0 || parseCount(argv[3], UINT32_MAX, &b) != 0) {
+            return 1;
+        }
+        return a <= b ? runEmitter(a, b) : 0;
+    }
+
+    if (argc == 5 && strcmp(argv[1], "--residues") == 0) {
+        uint64_t q, a, b;
+        if (parseCount(argv[2], RESIDUE_MAX_MODULUS, &q) != 0 || q == 0
+            || parseCount(argv[3], UINT32_MAX, &a) != 0 || parseCount(argv[4], UINT32_MAX, &b) != 0) {
+            return 1;
+        }
+        return a <= b ? runResidueCounter((uint32_t)q, a, b) : 0;
+    }
+
+    // A worker dropping its connection must surface as a send error, not kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    if (argc == 3 && strcmp(argv[1], "--worker") == 0) {
+        return runWorker(argv[2]);
+    }
+    if (argc >= 4 && strcmp(argv[1], "--coordinator") == 0) {
+        return runCoordinator(argc - 2, argv + 2);
+    }
+    usage(argv[0]);
+    return 1;
+}
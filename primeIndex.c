@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sieve.h"
+
+#define INDEX_MAGIC "PRIMEIDX"
+#define INDEX_VERSION 1
+#define BLOCK_SHIFT 16 // One prefix count every 2^16 integers
+#define BLOCK_SIZE (1ULL << BLOCK_SHIFT)
+#define INDEX_LIMIT (1ULL << 32) // The index covers [0, 2^32)
+#define NUM_BLOCKS ((uint32_t)(INDEX_LIMIT >> BLOCK_SHIFT))
+
+/*
+ * On-disk layout (native byte order, every field 4-byte aligned):
+ *   IndexHeader
+ *   uint32_t prefix[numBlocks + 1]  - prefix[k] = number of primes below k * 2^blockShift
+ *   uint32_t primes[numBasePrimes]  - all primes below 2^16, reused by the local sieves
+ *
+ * The file is mapped read-only, so a query touches two prefix entries and
+ * the few base primes its local sieve needs.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockShift;
+    uint32_t numBlocks;
+    uint32_t numBasePrimes;
+} IndexHeader;
+
+typedef struct {
+    const IndexHeader *header;
+    const uint32_t *prefix;
+    const uint32_t *primes;
+    uint64_t *scratch;
+    size_t mappedSize;
+} PrimeIndex;
+
+// Structure shared by the threads that build the index
+typedef struct {
+    const uint32_t *primes;
+    size_t numPrimes;
+    uint32_t *blockCounts;
+    atomic_uint nextBlock;
+} BuildState;
+
+// Worker thread function: claims blocks one at a time and counts their primes
+void* buildWorker(void *arg) {
+    BuildState *state = (BuildState*)arg;
+    uint64_t *scratch = (uint64_t*)malloc(sieveWords(0, BLOCK_SIZE) * sizeof(uint64_t));
+    if (!scratch) {
+        fprintf(stderr, "Failed to allocate memory for sieve segment.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t block;
+    while ((block = atomic_fetch_add(&state->nextBlock, 1)) < NUM_BLOCKS) {
+        uint64_t lo = (uint64_t)block << BLOCK_SHIFT;
+        state->blockCounts[block] = (uint32_t)sieveCount(lo, lo + BLOCK_SIZE, state->primes, state->numPrimes, scratch);
+    }
+
+    free(scratch);
+    return NULL;
+}
+
+int buildIndex(const char *path) {
+    size_t numPrimes;
+    uint32_t *primes = sieveBasePrimes(SIEVE_BASE_LIMIT, &numPrimes);
+
+    BuildState state;
+    state.primes = primes;
+    state.numPrimes = numPrimes;
+    state.blockCounts = (uint32_t*)malloc(NUM_BLOCKS * sizeof(uint32_t));
+    atomic_init(&state.nextBlock, 0);
+    if (!state.blockCounts) {
+        fprintf(stderr, "Failed to allocate memory for block counts.\n");
+        free(primes);
+        return 1;
+    }
+
+    // Determine the number of CPU cores
+    long numCPU = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numCPU < 1) {
+        numCPU = 1; // Fallback to at least one thread if detection fails
+    }
+
+    pthread_t *threads = (pthread_t*)malloc(numCPU * sizeof(pthread_t));
+    if (!threads) {
+        fprintf(stderr, "Failed to allocate memory for threads.\n");
+        free(state.blockCounts);
+        free(primes);
+        return 1;
+    }
+    for (long i = 0; i < numCPU; i++) {
+        if (pthread_create(&threads[i], NULL, buildWorker, &state) != 0) {
+            fprintf(stderr, "Failed to create thread %ld.\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (long i = 0; i < numCPU; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    // Turn the per-block counts into prefix counts in place
+    uint32_t *prefix = (uint32_t*)malloc((NUM_BLOCKS + 1) * sizeof(uint32_t));
+    if (!prefix) {
+        fprintf(stderr, "Failed to allocate memory for prefix counts.\n");
+        free(state.blockCounts);
+        free(primes);
+        return 1;
+    }
+    prefix[0] = 0;
+    for (uint32_t k = 0; k < NUM_BLOCKS; k++) {
+        prefix[k + 1] = prefix[k] + state.blockCounts[k];
+    }
+    free(state.blockCounts);
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.blockShift = BLOCK_SHIFT;
+    header.numBlocks = NUM_BLOCKS;
+    header.numBasePrimes = (uint32_t)numPrimes;
+
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        free(prefix);
+        free(primes);
+        return 1;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(prefix, sizeof(uint32_t), NUM_BLOCKS + 1, out) == NUM_BLOCKS + 1
+        && fwrite(primes, sizeof(uint32_t), numPrimes, out) == numPrimes;
+    if (fclose(out) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "Failed to write index file %s.\n", path);
+    } else {
+        printf("%u total primes below 2^32 indexed in %s.\n", prefix[NUM_BLOCKS], path);
+    }
+
+    free(prefix);
+    free(primes);
+    return ok ? 0 : 1;
+}
+
+int openIndex(const char *path, PrimeIndex *index) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        fprintf(stderr, "%s is not a prime index.\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    const IndexHeader *header = (const IndexHeader*)map;
+    size_t expected = sizeof(IndexHeader)
+        + ((size_t)header->numBlocks + 1 + header->numBasePrimes) * sizeof(uint32_t);
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0
+        || header->version != INDEX_VERSION
+        || header->blockShift != BLOCK_SHIFT
+        || header->numBlocks != NUM_BLOCKS
+        || expected != (size_t)st.st_size) {
+        fprintf(stderr, "%s is not a compatible prime index; rebuild it.\n", path);
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    index->header = header;
+    index->prefix = (const uint32_t*)(header + 1);
+    index->primes = index->prefix + header->numBlocks + 1;
+    index->mappedSize = (size_t)st.st_size;
+    index->scratch = (uint64_t*)malloc(sieveWords(0, BLOCK_SIZE) * sizeof(uint64_t));
+    if (!index->scratch) {
+        fprintf(stderr, "Failed to allocate memory for sieve segment.\n");
+        munmap(map, index->mappedSize);
+        return -1;
+    }
+    return 0;
+}
+
+void closeIndex(PrimeIndex *index) {
+    free(index->scratch);
+    munmap((void*)index->header, index->mappedSize);
+}
+
+/*
+ * Number of primes below x, for 0 <= x <= 2^32.
+ *
+ * Looks up the prefix counts of the two block boundaries around x and sieves
+ * only the shorter side, so at most half a block (2^15 integers) is sieved.
+ */
+uint64_t primesBelow(PrimeIndex *index, uint64_t x) {
+    uint64_t block = x >> BLOCK_SHIFT;
+    uint64_t lo = block << BLOCK_SHIFT;
+    if (x == lo) {
+        return index->prefix[block];
+    }
+    uint64_t hi = lo + BLOCK_SIZE;
+    size_t numPrimes = index->header->numBasePrimes;
+    if (x - lo <= hi - x) {
+        return index->prefix[block] + sieveCount(lo, x, index->primes, numPrimes, index->scratch);
+    }
+    return index->prefix[block + 1] - sieveCount(x, hi, index->primes, numPrimes, index->scratch);
+}
+
+// Number of primes in the closed interval [a, b]
+uint64_t countRange(PrimeIndex *index, uint64_t a, uint64_t b) {
+    if (a > b) return 0;
+    return primesBelow(index, b + 1) - primesBelow(index, a);
+}
+
+int parseBound(const char *text, uint64_t *value) {
+    char *end;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (*text == '\0' || *text == '-' || *end != '\0' || v >= INDEX_LIMIT) {
+        fprintf(stderr, "Bound must be an integer in [0, %llu]: %s\n", INDEX_LIMIT - 1, text);
+        return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+int queryIndex(const char *path, int argc, char *argv[]) {
+    PrimeIndex index;
+    if (openIndex(path, &index) != 0) {
+        return 1;
+    }
+
+    int status = 0;
+    if (argc == 2) {
+        uint64_t a, b;
+        if (parseBound(argv[0], &a) != 0 || parseBound(argv[1], &b) != 0) {
+            status = 1;
+        } else {
+            printf("%llu primes in [%llu, %llu].\n",
+                   (unsigned long long)countRange(&index, a, b),
+                   (unsigned long long)a, (unsigned long long)b);
+        }
+    } else {
+        // Interactive mode: one "a b" pair per line, one count per line
+        unsigned long long a, b;
+        while (scanf("%llu %llu", &a, &b) == 2) {
+            if (a >= INDEX_LIMIT || b >= INDEX_LIMIT) {
+                fprintf(stderr, "Bounds must be below %llu.\n", INDEX_LIMIT);
+                status = 1;
+                continue;
+            }
+            printf("%llu\n", (unsigned long long)countRange(&index, a, b));
+            fflush(stdout);
+        }
+    }
+
+    closeIndex(&index);
+    return status;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s build <index-file>\n", prog);
+    fprintf(stderr, "       %s query <index-file> [<a> <b>]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "build") == 0) {
+        return buildIndex(argv[2]);
+    }
+    if ((argc == 3 || argc == 5) && strcmp(argv[1], "query") == 0) {
+        return queryIndex(argv[2], argc - 3, argv + 3);
+    }
+    usage(argv[0]);
+    return 1;
+}
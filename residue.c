@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "residue.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define RESIDUE_X86 1
+#endif
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ * Residue-Masked Popcounts
+ *
+ * For a word with phase p, masks[p] holds one 64-bit mask per class. The word
+ * is broadcast, ANDed with the masks of 8 (AVX-512) or 4 (AVX2) classes at a
+ * time and popcounted per 64-bit lane, so the per-class counters live in
+ * vector lanes. The popcount is a nibble lookup with VPSHUFB followed by
+ * VPSADBW, which sums the bytes of each lane.
+ */
+static void maskedScalar(const ResidueClasses *rc, size_t phase, const uint64_t *bits, size_t words, uint64_t *counts) {
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = bits[w];
+        if (word) {
+            const uint64_t *m = rc->masks + phase * rc->stride;
+            for (size_t c = 0; c < rc->numClasses; c++) {
+                counts[c] += (uint64_t)__builtin_popcountll(word & m[c]);
+            }
+        }
+        if (++phase == rc->period) phase = 0;
+    }
+}
+
+#ifdef RESIDUE_X86
+
+__attribute__((target("avx512f,avx512bw")))
+static void maskedAvx512(const ResidueClasses *rc, size_t phase, const uint64_t *bits, size_t words, uint64_t *counts) {
+    const __m512i lut = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+    const __m512i nibble = _mm512_set1_epi8(0x0f);
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i acc[RESIDUE_MASK_MAX_CLASSES / 8];
+    size_t groups = rc->stride / 8;
+    for (size_t g = 0; g < groups; g++) {
+        acc[g] = zero;
+    }
+
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = bits[w];
+        if (word) {
+            __m512i b = _mm512_set1_epi64((long long)word);
+            const uint64_t *m = rc->masks + phase * rc->stride;
+            for (size_t g = 0; g < groups; g++) {
+                __m512i x = _mm512_and_si512(b, _mm512_loadu_si512((const void*)(m + 8 * g)));
+                __m512i lo = _mm512_shuffle_epi8(lut, _mm512_and_si512(x, nibble));
+                __m512i hi = _mm512_shuffle_epi8(lut, _mm512_and_si512(_mm512_srli_epi16(x, 4), nibble));
+                acc[g] = _mm512_add_epi64(acc[g], _mm512_sad_epu8(_mm512_add_epi8(lo, hi), zero));
+            }
+        }
+        if (++phase == rc->period) phase = 0;
+    }
+
+    for (size_t g = 0; g < groups; g++) {
+        __m512i sum = _mm512_add_epi64(acc[g], _mm512_loadu_si512((const void*)(counts + 8 * g)));
+        _mm512_storeu_si512((void*)(counts + 8 * g), sum);
+    }
+}
+
+__attribute__((target("avx2")))
+static void maskedAvx2(const ResidueClasses *rc, size_t phase, const uint64_t *bits, size_t words, uint64_t *counts) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc[RESIDUE_MASK_MAX_CLASSES / 4];
+    size_t groups = rc->stride / 4;
+    for (size_t g = 0; g < groups; g++) {
+        acc[g] = zero;
+    }
+
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = bits[w];
+        if (word) {
+            __m256i b = _mm256_set1_epi64x((long long)word);
+            const uint64_t *m = rc->masks + phase * rc->stride;
+            for (size_t g = 0; g < groups; g++) {
+                __m256i x = _mm256_and_si256(b, _mm256_loadu_si256((const __m256i*)(m + 4 * g)));
+                __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, nibble));
+                __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+                acc[g] = _mm256_add_epi64(acc[g], _mm256_sad_epu8(_mm256_add_epi8(lo, hi), zero));
+            }
+        }
+        if (++phase == rc->period) phase = 0;
+    }
+
+    for (size_t g = 0; g < groups; g++) {
+        __m256i sum = _mm256_add_epi64(acc[g], _mm256_loadu_si256((const __m256i*)(counts + 4 * g)));
+        _mm256_storeu_si256((__m256i*)(counts + 4 * g), sum);
+    }
+}
+
+#endif // RESIDUE_X86
+
+typedef void (*MaskedFn)(const ResidueClasses *rc, size_t phase, const uint64_t *bits, size_t words, uint64_t *counts);
+
+static MaskedFn maskedKernel = maskedScalar;
+
+// Large moduli: walk the set bits and look their class up, tracking 128W + 1 mod q per word
+static void scanClasses(const ResidueClasses *rc, uint64_t lo, const uint64_t *bits, size_t words, uint64_t *counts) {
+    uint32_t q = rc->q;
+    uint32_t step = 128 % q;
+    uint32_t r0 = (uint32_t)((lo + 1) % q);
+    for (size_t w = 0; w < words; w++) {
+        uint64_t m = bits[w];
+        while (m) {
+            int32_t c = rc->classOf[r0 + 2 * (uint32_t)__builtin_ctzll(m)];
+            if (c >= 0) counts[c]++;
+            m &= m - 1;
+        }
+        r0 += step;
+        if (r0 >= q) r0 -= q;
+    }
+}
+
+void initResidueClasses(ResidueClasses *rc, uint32_t q) {
+    memset(rc, 0, sizeof(*rc));
+    rc->q = q;
+    rc->residues = (uint32_t*)malloc(q * sizeof(uint32_t));
+    rc->classOf = (int32_t*)malloc(((size_t)q + 128) * sizeof(int32_t));
+    if (!rc->residues || !rc->classOf) {
+        fprintf(stderr, "Failed to allocate memory for residue classes.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t r = 0; r < q; r++) {
+        if (gcd(r, q) == 1) {
+            rc->classOf[r] = (int32_t)rc->numClasses;
+            rc->residues[rc->numClasses++] = r;
+        } else {
+            rc->classOf[r] = -1;
+        }
+    }
+    // Extended so classOf[r0 + 2j] needs no reduction for r0 < q and j < 64
+    for (uint32_t r = q; r < q + 128; r++) {
+        rc->classOf[r] = rc->classOf[r % q];
+    }
+
+    rc->stride = (rc->numClasses + 7) & ~(size_t)7;
+    rc->period = q / gcd(q, 128);
+    if (rc->numClasses > RESIDUE_MASK_MAX_CLASSES) return;
+
+    // Word W covers the odd numbers 128W + 2j + 1, and 128W mod q depends only on W mod period
+    rc->masks = (uint64_t*)calloc(rc->period * rc->stride, sizeof(uint64_t));
+    if (!rc->masks) {
+        fprintf(stderr, "Failed to allocate memory for residue masks.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t p = 0; p < rc->period; p++) {
+        for (uint32_t j = 0; j < 64; j++) {
+            int32_t c = rc->classOf[(128 * (uint64_t)p + 2 * j + 1) % q];
+            if (c >= 0) {
+                rc->masks[p * rc->stride + (size_t)c] |= 1ULL << j;
+            }
+        }
+    }
+
+#ifdef RESIDUE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        maskedKernel = maskedAvx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        maskedKernel = maskedAvx2;
+    }
+#endif
+}
+
+void freeResidueClasses(ResidueClasses *rc) {
+    free(rc->residues);
+    free(rc->classOf);
+    free(rc->masks);
+}
+
+void countResidues(const ResidueClasses *rc, uint64_t lo, const uint64_t *bits, size_t words, uint64_t *counts) {
+    if (!rc->masks) {
+        scanClasses(rc, lo, bits, words, counts);
+        return;
+    }
+    maskedKernel(rc, (size_t)((lo / 128) % rc->period), bits, words, counts);
+}
@@ -0,0 +1,41 @@
+#ifndef RESIDUE_H
+#define RESIDUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RESIDUE_MAX_MODULUS (1u << 20)
+
+// Above this many classes, scanning set bits beats one masked popcount per class
+#define RESIDUE_MASK_MAX_CLASSES 64
+
+/*
+ * The residue classes mod q that can hold more than one prime: those coprime to q.
+ * Primes dividing q are the only primes in the other classes and are left to the caller.
+ */
+typedef struct {
+    uint32_t q;
+    size_t numClasses;
+    uint32_t *residues; // residues[c] is the residue of class c
+    int32_t *classOf;   // classOf[r] for r < q + 128: class of r mod q, or -1 when not coprime
+    uint64_t *masks;    // masks[p * stride + c]: bits of a word with phase p that fall in class c
+    size_t period;      // Word phases repeat every period words (q / gcd(q, 128))
+    size_t stride;      // numClasses rounded up to a multiple of 8
+} ResidueClasses;
+
+/*
+ * Builds the class tables for modulus q (1 <= q <= RESIDUE_MAX_MODULUS).
+ * Exits the program if memory cannot be allocated.
+ */
+void initResidueClasses(ResidueClasses *rc, uint32_t q);
+
+void freeResidueClasses(ResidueClasses *rc);
+
+/*
+ * Adds the primes marked in a sieve bitmap (see sieveSegment) to counts[class].
+ * lo must be a multiple of 128 so every word starts at a known phase.
+ * counts has rc->stride entries.
+ */
+void countResidues(const ResidueClasses *rc, uint64_t lo, const uint64_t *bits, size_t words, uint64_t *counts);
+
+#endif // RESIDUE_H
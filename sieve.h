@@ -0,0 +1,38 @@
+#ifndef SIEVE_H
+#define SIEVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Largest base prime ever needed: every value we sieve is below 2^32
+#define SIEVE_BASE_LIMIT 65536
+
+/*
+ * Returns a malloc'ed array of all primes <= limit and stores its length
+ * in *count. Exits the program if memory cannot be allocated.
+ */
+uint32_t* sieveBasePrimes(uint32_t limit, size_t *count);
+
+/*
+ * Number of 64-bit words needed to sieve [lo, hi) with sieveSegment.
+ */
+size_t sieveWords(uint64_t lo, uint64_t hi);
+
+/*
+ * Segmented Sieve of Eratosthenes over the odd numbers of [lo, hi).
+ *
+ * lo must be even and hi at most 2^32. Bit i of bits stands for the odd number lo + 2i + 1 and is
+ * left set when that number is prime. Bits for numbers >= hi are cleared, so
+ * a popcount of the whole bitmap counts the odd primes of the segment.
+ * The caller provides sieveWords(lo, hi) words of storage and the primes up
+ * to sqrt(hi).
+ */
+void sieveSegment(uint64_t lo, uint64_t hi, const uint32_t *primes, size_t numPrimes, uint64_t *bits);
+
+/*
+ * Counts the primes in [a, b) with a local segmented sieve.
+ * scratch must hold sieveWords(a & ~1, b) words.
+ */
+uint64_t sieveCount(uint64_t a, uint64_t b, const uint32_t *primes, size_t numPrimes, uint64_t *scratch);
+
+#endif // SIEVE_H